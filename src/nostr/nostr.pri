@@ -1,4 +1,4 @@
-QT += network core websockets
+QT += network core concurrent websockets
 
 CONFIG += c++17
 
@@ -32,9 +32,16 @@ include(../thirdparty/thirdparty.pri)
 
 SOURCES += \
     $$PWD/qnostr.cpp \
-    $$PWD/qnostrrelay.cpp
+    $$PWD/qnostrrelay.cpp \
+    $$PWD/qnostreventreader.cpp \
+    $$PWD/qnostreventwriter.cpp \
+    $$PWD/qnostrkeysearch.cpp
 
 HEADERS += \
     $$PWD/qnostr.h \
     $$PWD/qnostrrelay.h \
+    $$PWD/qnostreventreader.h \
+    $$PWD/qnostreventwriter.h \
+    $$PWD/qnostrkeysearch.h \
+    $$PWD/qnostrbech32_p.h \
     $$PWD/qtnostr_global.h
@@ -1,6 +1,16 @@
 #include "qnostr.h"
 
 #include <QWebSocket>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QCache>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QTimer>
+#include <QtConcurrent>
+#include <QFutureInterface>
+
+#include <algorithm>
 
 #include <openssl/ec.h>
 #include <openssl/ecdh.h>
@@ -9,6 +19,19 @@
 #include <openssl/bio.h>
 #include <openssl/pem.h>
 
+#include "secp256k1_extrakeys.h"
+#include "qnostrbech32_p.h"
+
+// Pagination windows without a since start at one day and double going back
+const qint64 qnostr_paginationFirstSpan = 24 * 60 * 60;
+const int qnostr_paginationPageTimeout = 15000;
+
+// Future operations without any relay activity for this long time out, one
+// shared timer sweeps them. A finished, not canceled, future has an answer
+// from every relay.
+const qint64 qnostr_futureTimeout = 30000;
+const int qnostr_futureSweepInterval = 1000;
+
 class QNostr::Private
 {
 public:
@@ -17,14 +40,230 @@ public:
 
     QByteArray publicKey;
     QByteArray privateKey;
+
+    struct ReplaceableVersion {
+        qint64 createdAt = 0;
+        QString id;
+
+        bool isNewerThan(const ReplaceableVersion &other) const {
+            // NIP-01: On equal timestamps the lowest id wins
+            return createdAt > other.createdAt || (createdAt == other.createdAt && id < other.id);
+        }
+    };
+    struct HeldEvent {
+        ReplaceableVersion version;
+        QJsonObject object;
+    };
+    struct ReducerState {
+        QHash<QString, ReplaceableVersion> newest;
+        QHash<QUrl, QHash<QString, HeldEvent>> held;
+    };
+
+    bool reduceReplaceable = false;
+    QHash<QString, ReducerState> reducers;
+
+    struct CountMerge {
+        QSet<QUrl> pending;
+        qint64 count = 0;
+        bool partial = false;
+    };
+
+    QHash<QString, CountMerge> counts;
+
+    struct PaginationPage {
+        QString paginationId;
+        int window = 0;
+        QUrl relay;
+        qint64 until = 0;
+        qint64 oldest = 0;
+        qint64 received = 0;
+    };
+    struct PaginationWindow {
+        qint64 since = -1;
+        qint64 until = 0;
+        QSet<QUrl> pending;
+        QHash<QString, QPair<QNostrRelay::Event, QUrl>> events;
+    };
+    struct Pagination {
+        QNostrRelay::Request request;
+        int pageLimit = 0;
+        QList<PaginationWindow> windows;
+        QHash<QUrl, int> nextWindow;
+        int flushed = 0;
+        bool complete = true;
+    };
+
+    QHash<QString, Pagination> paginations;
+    QHash<QString, PaginationPage> paginationPages;
+
+    // Operations started through the future API report through their future
+    // only, and never through the signals
+    struct PendingPublish {
+        QFutureInterface<PublishResult> future;
+        QSet<QUrl> pending;
+        qint64 lastActivity = 0;
+    };
+    struct PendingQuery {
+        QFutureInterface<QNostrRelay::Event> future;
+        QSet<QUrl> pending;
+        qint64 lastActivity = 0;
+    };
+    struct PendingCount {
+        QFutureInterface<qint64> future;
+        qint64 lastActivity = 0;
+    };
+
+    QHash<QString, PendingPublish> publishes;
+    QHash<QString, PendingQuery> queries;
+    QHash<QString, PendingCount> countFutures;
+    QTimer *futuresTimer = nullptr;
+
+    struct ConversationKeys {
+        QByteArray sharedSecret;
+        QByteArray nip44Key;
+    };
+    struct ConversationKeyCache {
+        QMutex mutex;
+        QCache<QString, ConversationKeys> cache;
+    };
+
+    // Shared with the batch decrypt workers, which may outlive the QNostr
+    QSharedPointer<ConversationKeyCache> conversationKeys = QSharedPointer<ConversationKeyCache>::create();
+
+    static ConversationKeys conversationKeysOf(const QSharedPointer<ConversationKeyCache> &cache, const QByteArray &privateKey, const QString &peerPublicKey);
+    static QString decrypt(const QString &payload, const ConversationKeys &keys);
+
+    static QString replaceableKey(const QJsonObject &obj);
+    bool filterEvent(const QString &subscribeId, const QJsonObject &obj, bool storedEvent, const QUrl &url);
+    QList<QNostrRelay::Event> takeHeldEvents(const QString &subscribeId, const QUrl &url);
 };
 
+QNostr::Private::ConversationKeys QNostr::Private::conversationKeysOf(const QSharedPointer<ConversationKeyCache> &cache, const QByteArray &privateKey, const QString &peerPublicKey)
+{
+    const auto peer = peerPublicKey.toLower();
+    {
+        QMutexLocker locker(&cache->mutex);
+        if (auto keys = cache->cache.object(peer))
+            return *keys;
+    }
+
+    ConversationKeys keys;
+    keys.sharedSecret = QNostrRelay::sharedSecret(privateKey, peer);
+    if (keys.sharedSecret.isEmpty())
+        return keys;
+
+    keys.nip44Key = QNostrRelay::nip44ConversationKey(keys.sharedSecret);
+
+    QMutexLocker locker(&cache->mutex);
+    cache->cache.insert(peer, new ConversationKeys(keys));
+    return keys;
+}
+
+QString QNostr::Private::decrypt(const QString &payload, const ConversationKeys &keys)
+{
+    if (keys.sharedSecret.isEmpty())
+        return QString();
+    if (payload.contains(QStringLiteral("?iv=")))
+        return QNostrRelay::nip04Decrypt(payload, keys.sharedSecret);
+    return QNostrRelay::nip44Decrypt(payload, keys.nip44Key);
+}
+
+QString QNostr::Private::replaceableKey(const QJsonObject &obj)
+{
+    const auto kind = obj.value(QStringLiteral("kind")).toInt();
+    const auto pubkey = obj.value(QStringLiteral("pubkey")).toString();
+    if (QNostrRelay::Event::isReplaceableKind(kind))
+        return pubkey + QLatin1Char(':') + QString::number(kind);
+    if (!QNostrRelay::Event::isParameterizedReplaceableKind(kind))
+        return QString();
+
+    // Only the "d" tag is looked up, the rest of the tags stay untouched
+    QString d;
+    for (const auto &t: obj.value(QStringLiteral("tags")).toArray())
+    {
+        const auto tag = t.toArray();
+        if (tag.at(0).toString() != QStringLiteral("d"))
+            continue;
+
+        d = tag.at(1).toString();
+        break;
+    }
+
+    return pubkey + QLatin1Char(':') + QString::number(kind) + QLatin1Char(':') + d;
+}
+
+bool QNostr::Private::filterEvent(const QString &subscribeId, const QJsonObject &obj, bool storedEvent, const QUrl &url)
+{
+    if (!reduceReplaceable || paginationPages.contains(subscribeId))
+        return true;
+
+    const auto key = replaceableKey(obj);
+    if (key.isEmpty())
+        return true;
+
+    ReplaceableVersion version;
+    version.createdAt = obj.value(QStringLiteral("created_at")).toVariant().toLongLong();
+    version.id = obj.value(QStringLiteral("id")).toString();
+
+    auto &state = reducers[subscribeId];
+    const auto newest = state.newest.constFind(key);
+    if (newest != state.newest.constEnd() && !version.isNewerThan(newest.value()))
+        return false;
+
+    if (!storedEvent)
+    {
+        state.newest[key] = version;
+        return true;
+    }
+
+    // Stored events are held until EOSE, so only the winner gets deserialized
+    auto &held = state.held[url];
+    const auto current = held.constFind(key);
+    if (current != held.constEnd() && !version.isNewerThan(current->version))
+        return false;
+
+    HeldEvent h;
+    h.version = version;
+    h.object = obj;
+    held[key] = h;
+    return false;
+}
+
+QList<QNostrRelay::Event> QNostr::Private::takeHeldEvents(const QString &subscribeId, const QUrl &url)
+{
+    const auto state = reducers.find(subscribeId);
+    if (state == reducers.end())
+        return {};
+
+    const auto held = state->held.take(url);
+
+    QList<HeldEvent> winners;
+    for (auto i = held.constBegin(); i != held.constEnd(); i++)
+    {
+        const auto newest = state->newest.constFind(i.key());
+        if (newest != state->newest.constEnd() && !i->version.isNewerThan(newest.value()))
+            continue;
+
+        state->newest[i.key()] = i->version;
+        winners << i.value();
+    }
+
+    std::sort(winners.begin(), winners.end(), [](const HeldEvent &a, const HeldEvent &b){
+        return a.version.isNewerThan(b.version);
+    });
+
+    QList<QNostrRelay::Event> res;
+    for (const auto &w: winners)
+        res << QNostrRelay::Event::deserialize(w.object);
+    return res;
+}
+
 QNostr::QNostr(const QString &secretKey, QObject *parent)
     : QObject(parent)
 {
     p = new Private;
     p->privateKey = QNostrRelay::extractPrivateKey(secretKey.toLatin1());
-    p->publicKey = QNostrRelay::compressedPublicKey(secretKey);
+    p->publicKey = QNostrRelay::publicKeyFromPrivateKey(p->privateKey);
 }
 
 QNostr::QNostr(const QString &publicKey, const QString &privateKey, QObject *parent)
@@ -35,8 +274,33 @@ QNostr::QNostr(const QString &publicKey, const QString &privateKey, QObject *par
     p->privateKey = privateKey.toLatin1();
 }
 
+QNostr::QNostr(const KeyPair &keyPair, QObject *parent)
+    : QObject(parent)
+{
+    p = new Private;
+    p->privateKey = keyPair.privateKey.toBase64();
+    p->publicKey = QNostrRelay::publicKeyFromPrivateKey(p->privateKey);
+}
+
 QNostr::~QNostr()
 {
+    // Nobody will answer anymore, so waiters must not block forever
+    for (auto &publish: p->publishes)
+    {
+        publish.future.cancel();
+        publish.future.reportFinished();
+    }
+    for (auto &query: p->queries)
+    {
+        query.future.cancel();
+        query.future.reportFinished();
+    }
+    for (auto &count: p->countFutures)
+    {
+        count.future.cancel();
+        count.future.reportFinished();
+    }
+
     delete p;
 }
 
@@ -98,6 +362,62 @@ QString QNostr::generateNewSecret()
 
 #pragma GCC diagnostic pop
 
+QNostr::KeyPair QNostr::generateKeyPair()
+{
+    const auto list = generateKeyPairs(1);
+    return list.isEmpty()? KeyPair() : list.first();
+}
+
+QList<QNostr::KeyPair> QNostr::generateKeyPairs(int count)
+{
+    QList<KeyPair> res;
+    if (count <= 0)
+        return res;
+
+    auto ctx = secp256k1_context_create(SECP256K1_CONTEXT_NONE);
+
+    // One random draw for the whole batch, plus the context blinding seed
+    QByteArray random(32 * (count + 1), 0);
+    if (RAND_bytes(reinterpret_cast<unsigned char*>(random.data()), random.size()) != 1 ||
+        secp256k1_context_randomize(ctx, reinterpret_cast<const unsigned char*>(random.constData())) != 1)
+    {
+        qDebug() << "Failed to generate SECP key pair.";
+        secp256k1_context_destroy(ctx);
+        return res;
+    }
+
+    res.reserve(count);
+    for (int i = 1; i <= count; i++)
+    {
+        auto secret = reinterpret_cast<unsigned char*>(random.data()) + 32 * i;
+
+        secp256k1_keypair keypair;
+        while (secp256k1_keypair_create(ctx, &keypair, secret) != 1)
+            RAND_bytes(secret, 32);
+
+        secp256k1_xonly_pubkey xonly;
+        KeyPair k;
+        k.privateKey = QByteArray(reinterpret_cast<const char*>(secret), 32);
+        k.publicKey = QByteArray(32, 0);
+        secp256k1_keypair_xonly_pub(ctx, &xonly, nullptr, &keypair);
+        secp256k1_xonly_pubkey_serialize(ctx, reinterpret_cast<unsigned char*>(k.publicKey.data()), &xonly);
+        res << k;
+    }
+
+    secp256k1_context_destroy(ctx);
+    return res;
+}
+
+QString QNostr::KeyPair::publicKeyHex() const
+{
+    return QString::fromLatin1(publicKey.toHex());
+}
+
+QString QNostr::KeyPair::npub() const
+{
+    return qnostr_bech32Encode(QByteArrayLiteral("npub"), publicKey);
+}
+
 QList<QUrl> QNostr::relays() const
 {
     return p->relaysOrder;
@@ -122,6 +442,82 @@ void QNostr::setRelays(const QList<QUrl> &relays)
     Q_EMIT relaysChanged();
 }
 
+bool QNostr::reduceReplaceableEvents() const
+{
+    return p->reduceReplaceable;
+}
+
+void QNostr::setReduceReplaceableEvents(bool reduceReplaceableEvents)
+{
+    if (p->reduceReplaceable == reduceReplaceableEvents)
+        return;
+
+    p->reduceReplaceable = reduceReplaceableEvents;
+    Q_EMIT reduceReplaceableEventsChanged();
+}
+
+int QNostr::conversationKeyCacheSize() const
+{
+    QMutexLocker locker(&p->conversationKeys->mutex);
+    return p->conversationKeys->cache.maxCost();
+}
+
+void QNostr::setConversationKeyCacheSize(int conversationKeyCacheSize)
+{
+    {
+        QMutexLocker locker(&p->conversationKeys->mutex);
+        if (p->conversationKeys->cache.maxCost() == conversationKeyCacheSize)
+            return;
+
+        p->conversationKeys->cache.setMaxCost(conversationKeyCacheSize);
+    }
+    Q_EMIT conversationKeyCacheSizeChanged();
+}
+
+QString QNostr::encrypt(const QString &content, const QString &peerPublicKey, EncryptionVersion version) const
+{
+    const auto keys = Private::conversationKeysOf(p->conversationKeys, p->privateKey, peerPublicKey);
+    if (keys.sharedSecret.isEmpty())
+        return QString();
+
+    switch (version)
+    {
+    case Nip04Encryption:
+        return QNostrRelay::nip04Encrypt(content, keys.sharedSecret);
+    case Nip44Encryption:
+        return QNostrRelay::nip44Encrypt(content, keys.nip44Key);
+    }
+    return QString();
+}
+
+QString QNostr::decrypt(const QString &payload, const QString &peerPublicKey) const
+{
+    return Private::decrypt(payload, Private::conversationKeysOf(p->conversationKeys, p->privateKey, peerPublicKey));
+}
+
+QFuture<QString> QNostr::decryptEvents(const QList<QNostrRelay::Event> &events) const
+{
+    const auto cache = p->conversationKeys;
+    const auto privateKey = p->privateKey;
+    const auto publicKey = QString::fromLatin1(QByteArray::fromBase64(p->publicKey).mid(1).toHex().toLower());
+
+    std::function<QString(const QNostrRelay::Event &)> decryptor = [cache, privateKey, publicKey](const QNostrRelay::Event &e) {
+        // Messages we sent are decrypted against the first tagged recipient
+        auto peer = e.pubkey.value_or(QString());
+        if (peer == publicKey)
+            for (const auto &t: e.tags)
+                if (t.size() > 1 && t.at(0) == QStringLiteral("p"))
+                {
+                    peer = t.at(1);
+                    break;
+                }
+
+        return Private::decrypt(e.content, Private::conversationKeysOf(cache, privateKey, peer));
+    };
+
+    return QtConcurrent::mapped(events, decryptor);
+}
+
 void QNostr::addRelay(const QUrl &url)
 {
     if (p->relaysHash.contains(url))
@@ -129,16 +525,53 @@ void QNostr::addRelay(const QUrl &url)
 
     auto r = new QNostrRelay(url, QString::fromLatin1(p->publicKey), QString::fromLatin1(p->privateKey), this);
 
-    connect(r, &QNostrRelay::failed, this, [this, url](const QString &id, const QString &reason){ Q_EMIT failed(id, reason, url); });
-    connect(r, &QNostrRelay::successfully, this, [this, url](const QString &id){ Q_EMIT successfully(id, url); });
+    connect(r, &QNostrRelay::failed, this, [this, url](const QString &id, const QString &reason){
+        if (p->publishes.contains(id))
+            publishAnswered(id, url, false, reason);
+        else
+            Q_EMIT failed(id, reason, url);
+    });
+    connect(r, &QNostrRelay::successfully, this, [this, url](const QString &id){
+        if (p->publishes.contains(id))
+            publishAnswered(id, url, true, QString());
+        else
+            Q_EMIT successfully(id, url);
+    });
     connect(r, &QNostrRelay::error, this, [this, url](QAbstractSocket::SocketError err){ Q_EMIT error(err, url); });
     connect(r, &QNostrRelay::sslErrors, this, [this, url](const QList<QSslError> &errors){ Q_EMIT sslErrors(errors, url); });
-    connect(r, &QNostrRelay::newEvent, this, [this, url](const QString &subscribeId, const QNostrRelay::Event &event, bool storedEvent){ Q_EMIT newEvent(subscribeId, event, storedEvent, url); });
+    connect(r, &QNostrRelay::newEvent, this, [this, url](const QString &subscribeId, const QNostrRelay::Event &event, bool storedEvent){
+        if (p->paginationPages.contains(subscribeId))
+            paginationEvent(subscribeId, event, url);
+        else
+            deliverEvent(subscribeId, event, storedEvent, url);
+    });
     connect(r, &QNostrRelay::notice, this, [this, url](const QString &msg){ Q_EMIT notice(msg, url); });
-    connect(r, &QNostrRelay::syncEventsFinished, this, [this, url](const QString &subscribeId){ Q_EMIT syncEventsFinished(subscribeId, url); });
+    connect(r, &QNostrRelay::syncEventsFinished, this, [this, url](const QString &subscribeId){
+        if (p->paginationPages.contains(subscribeId))
+        {
+            paginationPageFinished(subscribeId, url);
+            return;
+        }
+
+        for (const auto &e: p->takeHeldEvents(subscribeId, url))
+            deliverEvent(subscribeId, e, true, url);
+
+        if (p->queries.contains(subscribeId))
+            queryFinished(subscribeId, url);
+        else
+            Q_EMIT syncEventsFinished(subscribeId, url);
+    });
+    connect(r, &QNostrRelay::countReceived, this, [this, url](const QString &subscribeId, qint64 count, bool partial){
+        if (!p->countFutures.contains(subscribeId))
+            Q_EMIT countReceived(subscribeId, count, partial, url);
+        countAnswered(subscribeId, url, count, partial);
+    });
     connect(r, &QNostrRelay::disconnected, this, [this, url](){ Q_EMIT QNostr::disconnected(url); });
     connect(r, &QNostrRelay::connected, this, [this, url](){ Q_EMIT QNostr::connected(url); });
 
+    r->setEventFilter([this, url](const QString &subscribeId, const QJsonObject &obj, bool storedEvent){
+        return p->filterEvent(subscribeId, obj, storedEvent, url);
+    });
     r->start();
 
     p->relaysHash[url] = r;
@@ -153,6 +586,19 @@ void QNostr::removeRelay(const QUrl &url)
     auto r = p->relaysHash.take(url);
     delete r;
     p->relaysOrder.removeAll(url);
+
+    for (auto &state: p->reducers)
+        state.held.remove(url);
+
+    for (const auto &subscribeId: p->counts.keys())
+        countAnswered(subscribeId, url, 0, true);
+    for (const auto &id: p->publishes.keys())
+        publishAnswered(id, url, false, QStringLiteral("relay removed"));
+    for (const auto &subscribeId: p->queries.keys())
+        queryFinished(subscribeId, url);
+
+    for (const auto &paginationId: p->paginations.keys())
+        dropPaginationRelay(paginationId, url, QStringLiteral("relay removed"));
 }
 
 QString QNostr::sendEvent(const QString &content)
@@ -181,14 +627,526 @@ QString QNostr::sendRequest(QNostrRelay::Request request)
     return request.subscriptionId.value();
 }
 
+QString QNostr::sendCount(QNostrRelay::Request request)
+{
+    request.subscriptionId = QUuid::createUuid().toString(QUuid::WithoutBraces).toUpper();
+
+    Private::CountMerge merge;
+    for (const auto &url: p->relaysOrder)
+        merge.pending.insert(url);
+    p->counts[request.subscriptionId.value()] = merge;
+
+    const auto subscribeId = request.subscriptionId.value();
+    if (merge.pending.isEmpty())
+        QTimer::singleShot(0, this, [this, subscribeId](){ finishCount(subscribeId); });
+
+    for (const auto &r: p->relaysHash)
+        r->sendCount(request);
+    return subscribeId;
+}
+
+void QNostr::countAnswered(const QString &subscribeId, const QUrl &sourceRelay, qint64 count, bool partial)
+{
+    auto merge = p->counts.find(subscribeId);
+    if (merge == p->counts.end() || !merge->pending.remove(sourceRelay))
+        return;
+
+    auto future = p->countFutures.find(subscribeId);
+    if (future != p->countFutures.end())
+    {
+        if (future->future.isCanceled())
+        {
+            sendClose(subscribeId);
+            return;
+        }
+        future->lastActivity = QDateTime::currentMSecsSinceEpoch();
+    }
+
+    // Relays share most of their events, so the largest answer is the closest
+    // estimate without having the event ids themselves
+    merge->count = qMax(merge->count, count);
+    merge->partial = merge->partial || partial;
+    if (merge->pending.isEmpty())
+        finishCount(subscribeId);
+}
+
+void QNostr::finishCount(const QString &subscribeId)
+{
+    auto merge = p->counts.find(subscribeId);
+    if (merge == p->counts.end() || !merge->pending.isEmpty())
+        return;
+
+    const auto res = merge->count;
+    const auto partial = merge->partial;
+    p->counts.erase(merge);
+
+    if (p->countFutures.contains(subscribeId))
+    {
+        auto future = p->countFutures.take(subscribeId).future;
+        future.reportResult(res);
+        future.reportFinished();
+        return;
+    }
+
+    Q_EMIT countFinished(subscribeId, res, partial);
+}
+
+void QNostr::watchFutures()
+{
+    if (!p->futuresTimer)
+    {
+        p->futuresTimer = new QTimer(this);
+        p->futuresTimer->setInterval(qnostr_futureSweepInterval);
+        connect(p->futuresTimer, &QTimer::timeout, this, &QNostr::sweepFutures);
+    }
+
+    if (!p->futuresTimer->isActive())
+        p->futuresTimer->start();
+}
+
+void QNostr::sweepFutures()
+{
+    const auto deadline = QDateTime::currentMSecsSinceEpoch() - qnostr_futureTimeout;
+
+    for (const auto &id: p->publishes.keys())
+    {
+        auto publish = p->publishes.value(id);
+        if (publish.future.isCanceled())
+        {
+            p->publishes.remove(id);
+            publish.future.reportFinished();
+        }
+        else if (publish.lastActivity < deadline)
+        {
+            // Relays that never answered are reported as timed out
+            for (const auto &url: publish.pending)
+                publishAnswered(id, url, false, QStringLiteral("timed out"));
+        }
+    }
+
+    // Canceled or stalled queries and counts are closed on the relays too,
+    // a stalled one is canceled since not every relay answered
+    for (const auto &subscribeId: p->queries.keys())
+    {
+        auto query = p->queries.value(subscribeId);
+        if (query.future.isCanceled() || query.lastActivity < deadline)
+        {
+            query.future.cancel();
+            sendClose(subscribeId);
+        }
+    }
+
+    for (const auto &subscribeId: p->countFutures.keys())
+    {
+        auto count = p->countFutures.value(subscribeId);
+        if (count.future.isCanceled() || count.lastActivity < deadline)
+        {
+            count.future.cancel();
+            sendClose(subscribeId);
+        }
+    }
+
+    if (p->publishes.isEmpty() && p->queries.isEmpty() && p->countFutures.isEmpty())
+        p->futuresTimer->stop();
+}
+
+QFuture<QNostr::PublishResult> QNostr::publishEvent(QNostrRelay::Event event)
+{
+    QNostrRelay::prepareEvent(event, p->publicKey, p->privateKey);
+    const auto id = event.id.value();
+
+    Private::PendingPublish publish;
+    publish.future.reportStarted();
+    for (const auto &url: p->relaysOrder)
+        publish.pending.insert(url);
+
+    const auto future = publish.future.future();
+    if (publish.pending.isEmpty())
+    {
+        publish.future.reportFinished();
+        return future;
+    }
+
+    publish.lastActivity = QDateTime::currentMSecsSinceEpoch();
+    p->publishes[id] = publish;
+    watchFutures();
+
+    for (const auto &r: p->relaysHash)
+        r->sendEvent(event, true);
+    return future;
+}
+
+void QNostr::publishAnswered(const QString &id, const QUrl &sourceRelay, bool accepted, const QString &message)
+{
+    auto publish = p->publishes.find(id);
+    if (publish == p->publishes.end() || !publish->pending.remove(sourceRelay))
+        return;
+
+    if (publish->future.isCanceled())
+    {
+        auto future = publish->future;
+        p->publishes.erase(publish);
+        future.reportFinished();
+        return;
+    }
+
+    publish->lastActivity = QDateTime::currentMSecsSinceEpoch();
+
+    PublishResult res;
+    res.relay = sourceRelay;
+    res.accepted = accepted;
+    res.message = message;
+    publish->future.reportResult(res);
+
+    if (!publish->pending.isEmpty())
+        return;
+
+    auto future = publish->future;
+    p->publishes.erase(publish);
+    future.reportFinished();
+}
+
+QFuture<QNostrRelay::Event> QNostr::queryEvents(QNostrRelay::Request request)
+{
+    request.subscriptionId = QUuid::createUuid().toString(QUuid::WithoutBraces).toUpper();
+    const auto subscribeId = request.subscriptionId.value();
+
+    Private::PendingQuery query;
+    query.future.reportStarted();
+    for (const auto &url: p->relaysOrder)
+        query.pending.insert(url);
+
+    const auto future = query.future.future();
+    if (query.pending.isEmpty())
+    {
+        query.future.reportFinished();
+        return future;
+    }
+
+    query.lastActivity = QDateTime::currentMSecsSinceEpoch();
+    p->queries[subscribeId] = query;
+    watchFutures();
+
+    for (const auto &r: p->relaysHash)
+        r->sendRequest(request);
+    return future;
+}
+
+void QNostr::deliverEvent(const QString &subscribeId, const QNostrRelay::Event &event, bool storedEvent, const QUrl &sourceRelay)
+{
+    auto query = p->queries.find(subscribeId);
+    if (query == p->queries.end())
+    {
+        Q_EMIT newEvent(subscribeId, event, storedEvent, sourceRelay);
+        return;
+    }
+
+    if (query->future.isCanceled())
+    {
+        sendClose(subscribeId);
+        return;
+    }
+
+    query->lastActivity = QDateTime::currentMSecsSinceEpoch();
+    query->future.reportResult(event);
+}
+
+void QNostr::queryFinished(const QString &subscribeId, const QUrl &sourceRelay)
+{
+    auto query = p->queries.find(subscribeId);
+    if (query == p->queries.end() || !query->pending.remove(sourceRelay))
+        return;
+
+    query->lastActivity = QDateTime::currentMSecsSinceEpoch();
+
+    // The query ends at EOSE, so the subscription is closed everywhere
+    if (query->pending.isEmpty() || query->future.isCanceled())
+        sendClose(subscribeId);
+}
+
+QFuture<qint64> QNostr::countEvents(QNostrRelay::Request request)
+{
+    QFutureInterface<qint64> future;
+    future.reportStarted();
+    if (p->relaysHash.isEmpty())
+    {
+        future.reportResult(0);
+        future.reportFinished();
+        return future.future();
+    }
+
+    Private::PendingCount count;
+    count.future = future;
+    count.lastActivity = QDateTime::currentMSecsSinceEpoch();
+
+    const auto subscribeId = sendCount(request);
+    p->countFutures[subscribeId] = count;
+    watchFutures();
+
+    return future.future();
+}
+
+QString QNostr::sendPaginatedRequest(QNostrRelay::Request request, int windows, int windowsInFlight, int pageLimit)
+{
+    const auto until = (request.until.has_value()? request.until->toSecsSinceEpoch() : QDateTime::currentSecsSinceEpoch());
+    if (request.since.has_value() && request.since->toSecsSinceEpoch() > until)
+    {
+        qDebug() << "Bad paginated request: since is after until.";
+        return QString();
+    }
+
+    const auto paginationId = QUuid::createUuid().toString(QUuid::WithoutBraces).toUpper();
+    windows = qMax(windows, 1);
+
+    Private::Pagination pagination;
+    pagination.request = request;
+    pagination.pageLimit = qMax(pageLimit, 1);
+
+    QSet<QUrl> relays;
+    for (const auto &url: p->relaysOrder)
+        relays.insert(url);
+
+    // Windows are ordered newest first and don't overlap, so every event
+    // belongs to exactly one of them
+    if (request.since.has_value())
+    {
+        const auto since = request.since->toSecsSinceEpoch();
+        const auto total = until - since + 1;
+        const auto count = static_cast<int>(qBound<qint64>(1, windows, total));
+        for (int i = 0; i < count; i++)
+        {
+            Private::PaginationWindow w;
+            w.until = until - total * i / count;
+            w.since = until + 1 - total * (i + 1) / count;
+            w.pending = relays;
+            pagination.windows << w;
+        }
+    }
+    else
+    {
+        // Without a lower bound the windows grow exponentially back from
+        // until, starting at a day, and the last one is open ended
+        qint64 end = until;
+        for (int i = 0; i < windows; i++)
+        {
+            Private::PaginationWindow w;
+            w.until = end;
+            w.since = (i == windows - 1? -1 : qMax<qint64>(until - qnostr_paginationFirstSpan * ((qint64(1) << qMin(i + 1, 40)) - 1) + 1, 0));
+            w.pending = relays;
+            pagination.windows << w;
+
+            if (w.since <= 0)
+            {
+                pagination.windows.last().since = -1;
+                break;
+            }
+            end = w.since - 1;
+        }
+    }
+
+    p->paginations[paginationId] = pagination;
+    if (relays.isEmpty())
+        QTimer::singleShot(0, this, [this, paginationId](){ flushPagination(paginationId); });
+
+    for (const auto &url: p->relaysOrder)
+        for (int i = 0; i < qMax(windowsInFlight, 1); i++)
+            startPaginationWindow(paginationId, url);
+
+    return paginationId;
+}
+
+void QNostr::startPaginationWindow(const QString &paginationId, const QUrl &sourceRelay)
+{
+    auto pagination = p->paginations.find(paginationId);
+    if (pagination == p->paginations.end())
+        return;
+
+    const auto window = pagination->nextWindow.value(sourceRelay);
+    if (window >= pagination->windows.size())
+        return;
+
+    pagination->nextWindow[sourceRelay] = window + 1;
+    sendPaginationPage(paginationId, window, sourceRelay, pagination->windows.at(window).until);
+}
+
+void QNostr::sendPaginationPage(const QString &paginationId, int window, const QUrl &sourceRelay, qint64 until)
+{
+    const auto &pagination = p->paginations[paginationId];
+    const auto &w = pagination.windows.at(window);
+
+    auto request = pagination.request;
+    request.subscriptionId.reset();
+    request.limit = pagination.pageLimit;
+    request.until = QDateTime::fromSecsSinceEpoch(until);
+    if (w.since >= 0)
+        request.since = QDateTime::fromSecsSinceEpoch(w.since);
+    else
+        request.since.reset();
+
+    Private::PaginationPage page;
+    page.paginationId = paginationId;
+    page.window = window;
+    page.relay = sourceRelay;
+    page.until = until;
+    page.oldest = until;
+
+    const auto subscribeId = p->relaysHash.value(sourceRelay)->sendRequest(request);
+    p->paginationPages[subscribeId] = page;
+
+    // A relay that doesn't finish a page in time, or never connects, is
+    // dropped from the pagination instead of holding it forever
+    QTimer::singleShot(qnostr_paginationPageTimeout, this, [this, subscribeId, paginationId, sourceRelay](){
+        if (!p->paginationPages.contains(subscribeId))
+            return;
+
+        qDebug() << sourceRelay.toString() << "did not finish a page in time. Dropping it from the pagination.";
+        dropPaginationRelay(paginationId, sourceRelay, QStringLiteral("page timed out"));
+    });
+}
+
+void QNostr::dropPaginationRelay(const QString &paginationId, const QUrl &sourceRelay, const QString &reason)
+{
+    for (auto i = p->paginationPages.begin(); i != p->paginationPages.end(); )
+    {
+        if (i->paginationId != paginationId || i->relay != sourceRelay)
+        {
+            i++;
+            continue;
+        }
+
+        if (auto r = p->relaysHash.value(sourceRelay))
+            r->sendClose(i.key());
+        i = p->paginationPages.erase(i);
+    }
+
+    auto pagination = p->paginations.find(paginationId);
+    if (pagination == p->paginations.end())
+        return;
+
+    for (auto &w: pagination->windows)
+        w.pending.remove(sourceRelay);
+    pagination->nextWindow[sourceRelay] = pagination->windows.size();
+    pagination->complete = false;
+
+    Q_EMIT failed(paginationId, reason, sourceRelay);
+    flushPagination(paginationId);
+}
+
+void QNostr::paginationEvent(const QString &subscribeId, const QNostrRelay::Event &event, const QUrl &sourceRelay)
+{
+    auto &page = p->paginationPages[subscribeId];
+    auto pagination = p->paginations.find(page.paginationId);
+    if (pagination == p->paginations.end())
+        return;
+
+    const auto createdAt = event.created_at.value_or(QDateTime()).toSecsSinceEpoch();
+    page.received++;
+    page.oldest = qMin(page.oldest, createdAt);
+
+    auto &events = pagination->windows[page.window].events;
+    const auto id = event.id.value_or(QString());
+    if (!events.contains(id))
+        events[id] = qMakePair(event, sourceRelay);
+}
+
+void QNostr::paginationPageFinished(const QString &subscribeId, const QUrl &sourceRelay)
+{
+    const auto page = p->paginationPages.take(subscribeId);
+    p->relaysHash.value(sourceRelay)->sendClose(subscribeId);
+
+    auto pagination = p->paginations.find(page.paginationId);
+    if (pagination == p->paginations.end())
+        return;
+
+    // Keep walking "until" back from the oldest event of the page. The oldest
+    // second is requested again, unless the whole page was stuck on it.
+    auto &w = pagination->windows[page.window];
+    if (page.received > 0)
+    {
+        const auto next = (page.oldest < page.until? page.oldest : page.oldest - 1);
+        if (next >= qMax<qint64>(w.since, 0))
+        {
+            sendPaginationPage(page.paginationId, page.window, sourceRelay, next);
+            return;
+        }
+    }
+
+    w.pending.remove(sourceRelay);
+    startPaginationWindow(page.paginationId, sourceRelay);
+    flushPagination(page.paginationId);
+}
+
+void QNostr::flushPagination(const QString &paginationId)
+{
+    while (true)
+    {
+        auto pagination = p->paginations.find(paginationId);
+        if (pagination == p->paginations.end())
+            return;
+
+        if (pagination->flushed == pagination->windows.size())
+        {
+            const auto complete = pagination->complete;
+            p->paginations.erase(pagination);
+            Q_EMIT paginationFinished(paginationId, complete);
+            return;
+        }
+
+        auto &w = pagination->windows[pagination->flushed];
+        if (!w.pending.isEmpty())
+            return;
+
+        auto events = w.events.values();
+        w.events.clear();
+        pagination->flushed++;
+
+        std::sort(events.begin(), events.end(), [](const QPair<QNostrRelay::Event, QUrl> &a, const QPair<QNostrRelay::Event, QUrl> &b){
+            if (a.first.created_at != b.first.created_at)
+                return a.first.created_at > b.first.created_at;
+            return a.first.id < b.first.id;
+        });
+
+        for (const auto &e: events)
+            Q_EMIT newEvent(paginationId, e.first, true, e.second);
+    }
+}
+
+void QNostr::closePagination(const QString &paginationId)
+{
+    if (!p->paginations.remove(paginationId))
+        return;
+
+    for (auto i = p->paginationPages.begin(); i != p->paginationPages.end(); )
+    {
+        if (i->paginationId != paginationId)
+        {
+            i++;
+            continue;
+        }
+
+        if (auto r = p->relaysHash.value(i->relay))
+            r->sendClose(i.key());
+        i = p->paginationPages.erase(i);
+    }
+}
+
 void QNostr::sendClose(const QNostrRelay::Close &request)
 {
+    closePagination(request.subscriptionId);
+    p->reducers.remove(request.subscriptionId);
+    p->counts.remove(request.subscriptionId);
     for (const auto &r: p->relaysHash)
         r->sendClose(request);
+
+    if (p->queries.contains(request.subscriptionId))
+        p->queries.take(request.subscriptionId).future.reportFinished();
+    if (p->countFutures.contains(request.subscriptionId))
+        p->countFutures.take(request.subscriptionId).future.reportFinished();
 }
 
 void QNostr::sendClose(const QString &subscriptionId)
 {
-    for (const auto &r: p->relaysHash)
-        r->sendClose(subscriptionId);
+    QNostrRelay::Close c;
+    c.subscriptionId = subscriptionId;
+    sendClose(c);
 }
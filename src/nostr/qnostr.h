@@ -4,6 +4,7 @@
 #include <QObject>
 #include <QAbstractSocket>
 #include <QSslError>
+#include <QFuture>
 
 #include "qnostrrelay.h"
 
@@ -13,21 +14,60 @@ class LIBQTNOSTR_CORE_EXPORT QNostr : public QObject
 {
     Q_OBJECT
     Q_PROPERTY(QList<QUrl> relays READ relays WRITE setRelays NOTIFY relaysChanged)
+    Q_PROPERTY(bool reduceReplaceableEvents READ reduceReplaceableEvents WRITE setReduceReplaceableEvents NOTIFY reduceReplaceableEventsChanged)
+    Q_PROPERTY(int conversationKeyCacheSize READ conversationKeyCacheSize WRITE setConversationKeyCacheSize NOTIFY conversationKeyCacheSizeChanged)
     class Private;
 
 public:
+    enum EncryptionVersion {
+        Nip04Encryption,
+        Nip44Encryption
+    };
+    Q_ENUM(EncryptionVersion)
+
+    struct LIBQTNOSTR_CORE_EXPORT KeyPair {
+        QByteArray privateKey;
+        QByteArray publicKey;
+
+        QString publicKeyHex() const;
+        QString npub() const;
+    };
+
+    struct LIBQTNOSTR_CORE_EXPORT PublishResult {
+        QUrl relay;
+        bool accepted = false;
+        QString message;
+    };
+
     QNostr(const QString &secretKey, QObject *parent = nullptr);
     QNostr(const QString &publicKey, const QString &privateKey, QObject *parent = nullptr);
+    QNostr(const KeyPair &keyPair, QObject *parent = nullptr);
     virtual ~QNostr();
 
     QString publicKey() const;
     QString privateKey() const;
 
     static QString generateNewSecret();
+    static KeyPair generateKeyPair();
+    static QList<KeyPair> generateKeyPairs(int count);
 
     QList<QUrl> relays() const;
     void setRelays(const QList<QUrl> &relays);
 
+    bool reduceReplaceableEvents() const;
+    void setReduceReplaceableEvents(bool reduceReplaceableEvents);
+
+    int conversationKeyCacheSize() const;
+    void setConversationKeyCacheSize(int conversationKeyCacheSize);
+
+    QString encrypt(const QString &content, const QString &peerPublicKey, EncryptionVersion version = Nip44Encryption) const;
+    QString decrypt(const QString &payload, const QString &peerPublicKey) const;
+    QFuture<QString> decryptEvents(const QList<QNostrRelay::Event> &events) const;
+
+    QFuture<PublishResult> publishEvent(QNostrRelay::Event event);
+    QFuture<QNostrRelay::Event> queryEvents(QNostrRelay::Request request);
+    QFuture<qint64> countEvents(QNostrRelay::Request request);
+
 public Q_SLOTS:
     void addRelay(const QUrl &url);
     void removeRelay(const QUrl &url);
@@ -35,6 +75,8 @@ public Q_SLOTS:
     QString sendEvent(const QString &content);
     QString sendEvent(QNostrRelay::Event event);
     QString sendRequest(QNostrRelay::Request request);
+    QString sendCount(QNostrRelay::Request request);
+    QString sendPaginatedRequest(QNostrRelay::Request request, int windows = 8, int windowsInFlight = 3, int pageLimit = 500);
     void sendClose(const QNostrRelay::Close &request);
     void sendClose(const QString &subscriptionId);
 
@@ -46,9 +88,31 @@ Q_SIGNALS:
     void newEvent(const QString &subscribeId, const QNostrRelay::Event &event, bool storedEvent, const QUrl &sourceRelay);
     void notice(const QString &msg, const QUrl &sourceRelay);
     void syncEventsFinished(const QString &subscribeId, const QUrl &sourceRelay);
+    void countReceived(const QString &subscribeId, qint64 count, bool partial, const QUrl &sourceRelay);
+    void countFinished(const QString &subscribeId, qint64 count, bool partial);
+    void paginationFinished(const QString &subscribeId, bool complete);
     void disconnected(const QUrl &sourceRelay);
     void connected(const QUrl &sourceRelay);
     void relaysChanged();
+    void reduceReplaceableEventsChanged();
+    void conversationKeyCacheSizeChanged();
+
+private:
+    void countAnswered(const QString &subscribeId, const QUrl &sourceRelay, qint64 count, bool partial);
+    void finishCount(const QString &subscribeId);
+    void watchFutures();
+    void sweepFutures();
+    void publishAnswered(const QString &id, const QUrl &sourceRelay, bool accepted, const QString &message);
+    void deliverEvent(const QString &subscribeId, const QNostrRelay::Event &event, bool storedEvent, const QUrl &sourceRelay);
+    void queryFinished(const QString &subscribeId, const QUrl &sourceRelay);
+
+    void startPaginationWindow(const QString &paginationId, const QUrl &sourceRelay);
+    void sendPaginationPage(const QString &paginationId, int window, const QUrl &sourceRelay, qint64 until);
+    void dropPaginationRelay(const QString &paginationId, const QUrl &sourceRelay, const QString &reason);
+    void paginationEvent(const QString &subscribeId, const QNostrRelay::Event &event, const QUrl &sourceRelay);
+    void paginationPageFinished(const QString &subscribeId, const QUrl &sourceRelay);
+    void flushPagination(const QString &paginationId);
+    void closePagination(const QString &paginationId);
 
 private:
     Private *p;
@@ -0,0 +1,68 @@
+#ifndef QNOSTRBECH32_P_H
+#define QNOSTRBECH32_P_H
+
+// Private bech32 helpers shared by the module sources, not part of the API
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+
+inline const QByteArray &qnostr_bech32Charset()
+{
+    static const QByteArray charset = QByteArrayLiteral("qpzry9x8gf2tvdw0s3jn54khce6mua7l");
+    return charset;
+}
+
+inline quint32 qnostr_bech32Polymod(const QList<int> &values)
+{
+    static const quint32 generator[] = {0x3b6a57b2, 0x26508e6d, 0x1ea119fa, 0x3d4233dd, 0x2a1462b3};
+
+    quint32 chk = 1;
+    for (auto v: values)
+    {
+        const auto top = chk >> 25;
+        chk = ((chk & 0x1ffffff) << 5) ^ v;
+        for (int i = 0; i < 5; i++)
+            if ((top >> i) & 1)
+                chk ^= generator[i];
+    }
+    return chk;
+}
+
+inline QString qnostr_bech32Encode(const QByteArray &hrp, const QByteArray &data)
+{
+    QList<int> values;
+    quint32 acc = 0;
+    int bits = 0;
+    for (auto c: data)
+    {
+        acc = (acc << 8) | static_cast<uchar>(c);
+        bits += 8;
+        while (bits >= 5)
+        {
+            bits -= 5;
+            values << ((acc >> bits) & 31);
+        }
+    }
+    if (bits)
+        values << ((acc << (5 - bits)) & 31);
+
+    QList<int> checked;
+    for (auto c: hrp)
+        checked << (c >> 5);
+    checked << 0;
+    for (auto c: hrp)
+        checked << (c & 31);
+    checked << values << QList<int>{0, 0, 0, 0, 0, 0};
+
+    const auto mod = qnostr_bech32Polymod(checked) ^ 1;
+    for (int i = 0; i < 6; i++)
+        values << ((mod >> (5 * (5 - i))) & 31);
+
+    QString res = QString::fromLatin1(hrp) + QLatin1Char('1');
+    for (auto v: values)
+        res += QLatin1Char(qnostr_bech32Charset().at(v));
+    return res;
+}
+
+#endif // QNOSTRBECH32_P_H
@@ -0,0 +1,240 @@
+#include "qnostreventreader.h"
+
+#include <QFile>
+#include <QQueue>
+#include <QThread>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QtConcurrent>
+
+#include <cstring>
+
+class QNostrEventReader::Private
+{
+public:
+    QString path;
+    bool verify = true;
+    qint64 chunkSize = 4 * 1024 * 1024;
+
+    qint64 readEvents = 0;
+    qint64 rejectedEvents = 0;
+
+    struct Chunk {
+        QList<QNostrRelay::Event> events;
+        qint64 rejected = 0;
+    };
+
+    // A piece of the file, either mapped or read, that is in flight
+    struct Window {
+        QFuture<Chunk> future;
+        uchar *mapped = nullptr;
+        QByteArray buffer;
+        const char *data = nullptr;
+        qint64 size = 0;
+    };
+
+    static Chunk parse(const char *begin, const char *end, bool verify);
+    static bool obtain(QFile &file, qint64 pos, qint64 length, Window &window);
+    static void release(QFile &file, Window &window);
+};
+
+bool QNostrEventReader::Private::obtain(QFile &file, qint64 pos, qint64 length, Window &window)
+{
+    window.mapped = file.map(pos, length);
+    if (window.mapped)
+    {
+        window.data = reinterpret_cast<const char*>(window.mapped);
+        window.size = length;
+        return true;
+    }
+
+    // Fallback to a plain read of the same window when it can not be mapped
+    if (!file.seek(pos))
+        return false;
+
+    window.buffer = file.read(length);
+    window.data = window.buffer.constData();
+    window.size = window.buffer.size();
+    return window.size > 0;
+}
+
+void QNostrEventReader::Private::release(QFile &file, Window &window)
+{
+    if (window.mapped)
+        file.unmap(window.mapped);
+
+    window.mapped = nullptr;
+    window.buffer.clear();
+    window.data = nullptr;
+    window.size = 0;
+}
+
+QNostrEventReader::Private::Chunk QNostrEventReader::Private::parse(const char *begin, const char *end, bool verify)
+{
+    Chunk res;
+    while (begin < end)
+    {
+        auto lineEnd = static_cast<const char*>(memchr(begin, '\n', end - begin));
+        if (!lineEnd)
+            lineEnd = end;
+
+        const auto line = QByteArray::fromRawData(begin, lineEnd - begin).trimmed();
+        begin = lineEnd + 1;
+        if (line.isEmpty())
+            continue;
+
+        QJsonParseError error;
+        const auto doc = QJsonDocument::fromJson(line, &error);
+        if (error.error != QJsonParseError::NoError || !doc.isObject())
+        {
+            res.rejected++;
+            continue;
+        }
+
+        auto e = QNostrRelay::Event::deserialize(doc.object());
+        if (verify && !e.verify())
+        {
+            res.rejected++;
+            continue;
+        }
+
+        res.events << e;
+    }
+
+    return res;
+}
+
+QNostrEventReader::QNostrEventReader(const QString &path)
+{
+    p = new Private;
+    p->path = path;
+}
+
+QNostrEventReader::~QNostrEventReader()
+{
+    delete p;
+}
+
+QString QNostrEventReader::path() const
+{
+    return p->path;
+}
+
+bool QNostrEventReader::verify() const
+{
+    return p->verify;
+}
+
+void QNostrEventReader::setVerify(bool verify)
+{
+    p->verify = verify;
+}
+
+qint64 QNostrEventReader::chunkSize() const
+{
+    return p->chunkSize;
+}
+
+void QNostrEventReader::setChunkSize(qint64 chunkSize)
+{
+    p->chunkSize = qMax<qint64>(chunkSize, 1);
+}
+
+qint64 QNostrEventReader::readEvents() const
+{
+    return p->readEvents;
+}
+
+qint64 QNostrEventReader::rejectedEvents() const
+{
+    return p->rejectedEvents;
+}
+
+bool QNostrEventReader::read(const Handler &handler)
+{
+    p->readEvents = 0;
+    p->rejectedEvents = 0;
+
+    QFile file(p->path);
+    if (!file.open(QFile::ReadOnly))
+    {
+        qDebug() << "Failed to open" << p->path << file.errorString();
+        return false;
+    }
+
+    const auto size = file.size();
+    const auto verify = p->verify;
+    const auto maxPending = qMax(QThread::idealThreadCount(), 1) * 2;
+
+    // Windows are parsed in parallel but handed over in file order, and only
+    // a bounded number of them is mapped or loaded at once
+    QQueue<Private::Window> pending;
+    bool cancelled = false;
+    bool failed = false;
+    auto consume = [&](){
+        auto window = pending.dequeue();
+        const auto chunk = window.future.result();
+        Private::release(file, window);
+
+        p->rejectedEvents += chunk.rejected;
+        if (cancelled)
+            return;
+
+        p->readEvents += chunk.events.size();
+        if (!chunk.events.isEmpty() && !handler(chunk.events))
+            cancelled = true;
+    };
+
+    qint64 pos = 0;
+    while (pos < size && !cancelled)
+    {
+        Private::Window window;
+        auto length = qMin(p->chunkSize, size - pos);
+        while (true)
+        {
+            if (!Private::obtain(file, pos, length, window))
+            {
+                qDebug() << "Failed to read" << p->path << file.errorString();
+                failed = true;
+                break;
+            }
+            if (pos + window.size >= size)
+                break;
+
+            // Cut the window after its last complete line
+            auto cut = window.size;
+            while (cut > 0 && window.data[cut - 1] != '\n')
+                cut--;
+            if (cut > 0)
+            {
+                window.size = cut;
+                break;
+            }
+
+            // A single line is longer than the window. A short read of the
+            // last window is taken as it is.
+            if (length >= size - pos)
+                break;
+
+            Private::release(file, window);
+            length = qMin(length * 2, size - pos);
+        }
+
+        if (failed)
+            break;
+
+        const auto begin = window.data;
+        const auto end = window.data + window.size;
+        window.future = QtConcurrent::run([begin, end, verify](){ return Private::parse(begin, end, verify); });
+        pos += window.size;
+        pending.enqueue(window);
+
+        if (pending.size() >= maxPending)
+            consume();
+    }
+
+    while (pending.size())
+        consume();
+
+    return !cancelled && !failed;
+}
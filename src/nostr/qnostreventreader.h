@@ -0,0 +1,40 @@
+#ifndef QNOSTREVENTREADER_H
+#define QNOSTREVENTREADER_H
+
+#include <functional>
+
+#include "qnostrrelay.h"
+
+QT_BEGIN_NAMESPACE
+
+class LIBQTNOSTR_CORE_EXPORT QNostrEventReader
+{
+    Q_DISABLE_COPY(QNostrEventReader)
+    class Private;
+
+public:
+    typedef std::function<bool(const QList<QNostrRelay::Event> &events)> Handler;
+
+    QNostrEventReader(const QString &path);
+    virtual ~QNostrEventReader();
+
+    QString path() const;
+
+    bool verify() const;
+    void setVerify(bool verify);
+
+    qint64 chunkSize() const;
+    void setChunkSize(qint64 chunkSize);
+
+    qint64 readEvents() const;
+    qint64 rejectedEvents() const;
+
+    bool read(const Handler &handler);
+
+private:
+    Private *p;
+};
+
+QT_END_NAMESPACE
+
+#endif // QNOSTREVENTREADER_H
@@ -0,0 +1,119 @@
+#include "qnostreventwriter.h"
+
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+class QNostrEventWriter::Private
+{
+public:
+    QFile file;
+    QByteArray buffer;
+    qint64 bufferSize = 4 * 1024 * 1024;
+    qint64 writtenEvents = 0;
+    qint64 bufferedEvents = 0;
+};
+
+QNostrEventWriter::QNostrEventWriter(const QString &path)
+{
+    p = new Private;
+    p->file.setFileName(path);
+}
+
+QNostrEventWriter::~QNostrEventWriter()
+{
+    close();
+    delete p;
+}
+
+QString QNostrEventWriter::path() const
+{
+    return p->file.fileName();
+}
+
+qint64 QNostrEventWriter::bufferSize() const
+{
+    return p->bufferSize;
+}
+
+void QNostrEventWriter::setBufferSize(qint64 bufferSize)
+{
+    p->bufferSize = qMax<qint64>(bufferSize, 1);
+}
+
+qint64 QNostrEventWriter::writtenEvents() const
+{
+    return p->writtenEvents;
+}
+
+bool QNostrEventWriter::open(bool append)
+{
+    if (p->file.isOpen())
+        return true;
+
+    if (!p->file.open(append? QFile::WriteOnly | QFile::Append : QFile::WriteOnly | QFile::Truncate))
+    {
+        qDebug() << "Failed to open" << p->file.fileName() << p->file.errorString();
+        return false;
+    }
+
+    // Reserved capacity survives resize(0), so the buffer is allocated once
+    p->buffer.reserve(p->bufferSize + 64 * 1024);
+    p->writtenEvents = 0;
+    p->bufferedEvents = 0;
+    return true;
+}
+
+bool QNostrEventWriter::write(const QNostrRelay::Event &event)
+{
+    if (!p->file.isOpen())
+        return false;
+
+    p->buffer += QJsonDocument(event.toJsonObject()).toJson(QJsonDocument::Compact);
+    p->buffer += '\n';
+    p->bufferedEvents++;
+
+    if (p->buffer.size() >= p->bufferSize)
+        return flush();
+    return true;
+}
+
+bool QNostrEventWriter::write(const QList<QNostrRelay::Event> &events)
+{
+    for (const auto &e: events)
+        if (!write(e))
+            return false;
+    return true;
+}
+
+bool QNostrEventWriter::flush()
+{
+    if (!p->file.isOpen())
+        return false;
+    if (p->buffer.isEmpty())
+        return true;
+
+    const auto written = p->file.write(p->buffer);
+    if (written != p->buffer.size())
+    {
+        // Keep what did not reach the file, the events are not counted yet
+        qDebug() << "Failed to write" << p->file.fileName() << p->file.errorString();
+        if (written > 0)
+            p->buffer.remove(0, written);
+        return false;
+    }
+
+    p->writtenEvents += p->bufferedEvents;
+    p->bufferedEvents = 0;
+    p->buffer.resize(0);
+    return true;
+}
+
+void QNostrEventWriter::close()
+{
+    if (!p->file.isOpen())
+        return;
+
+    flush();
+    p->file.close();
+}
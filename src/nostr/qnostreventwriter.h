@@ -0,0 +1,36 @@
+#ifndef QNOSTREVENTWRITER_H
+#define QNOSTREVENTWRITER_H
+
+#include "qnostrrelay.h"
+
+QT_BEGIN_NAMESPACE
+
+class LIBQTNOSTR_CORE_EXPORT QNostrEventWriter
+{
+    Q_DISABLE_COPY(QNostrEventWriter)
+    class Private;
+
+public:
+    QNostrEventWriter(const QString &path);
+    virtual ~QNostrEventWriter();
+
+    QString path() const;
+
+    qint64 bufferSize() const;
+    void setBufferSize(qint64 bufferSize);
+
+    qint64 writtenEvents() const;
+
+    bool open(bool append = false);
+    bool write(const QNostrRelay::Event &event);
+    bool write(const QList<QNostrRelay::Event> &events);
+    bool flush();
+    void close();
+
+private:
+    Private *p;
+};
+
+QT_END_NAMESPACE
+
+#endif // QNOSTREVENTWRITER_H
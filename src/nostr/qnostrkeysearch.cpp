@@ -0,0 +1,267 @@
+#include "qnostrkeysearch.h"
+#include "secp256k1.h"
+#include "qnostrbech32_p.h"
+
+#include <QThread>
+#include <QThreadPool>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QAtomicInteger>
+#include <QSharedPointer>
+#include <QtEndian>
+
+#include <openssl/rand.h>
+
+#include <cstring>
+
+// Workers publish their counters in steps, to keep the shared cache line quiet
+const int qnostr_keySearchReportStep = 1024;
+
+class QNostrKeySearch::Private
+{
+public:
+    struct State {
+        QAtomicInt stopped;
+        QAtomicInteger<qint64> tested;
+    };
+
+    QThreadPool pool;
+    QSharedPointer<State> state;
+    QTimer *progressTimer;
+    QElapsedTimer elapsed;
+    qint64 lastTested = 0;
+    qint64 lastElapsed = 0;
+
+    static bool matchHex(const unsigned char *key, const QByteArray &prefix);
+    static bool matchBech32(const unsigned char *key, const QByteArray &prefix);
+    static void search(QSharedPointer<State> state, QByteArray prefix, PrefixType type, QNostrKeySearch *search);
+};
+
+bool QNostrKeySearch::Private::matchHex(const unsigned char *key, const QByteArray &prefix)
+{
+    for (int i = 0; i < prefix.size(); i++)
+    {
+        const auto nibble = (i % 2? key[i / 2] & 0xF : key[i / 2] >> 4);
+        if (nibble != prefix.at(i))
+            return false;
+    }
+    return true;
+}
+
+bool QNostrKeySearch::Private::matchBech32(const unsigned char *key, const QByteArray &prefix)
+{
+    quint32 acc = 0;
+    int bits = 0;
+    int byte = 0;
+    for (int i = 0; i < prefix.size(); i++)
+    {
+        if (bits < 5)
+        {
+            acc = ((acc << 8) | key[byte++]) & 0xFFFF;
+            bits += 8;
+        }
+
+        bits -= 5;
+        if (static_cast<char>((acc >> bits) & 31) != prefix.at(i))
+            return false;
+    }
+    return true;
+}
+
+void QNostrKeySearch::Private::search(QSharedPointer<State> state, QByteArray prefix, PrefixType type, QNostrKeySearch *search)
+{
+    auto ctx = secp256k1_context_create(SECP256K1_CONTEXT_NONE);
+
+    unsigned char seed[32];
+    if (RAND_bytes(seed, 32) != 1 || secp256k1_context_randomize(ctx, seed) != 1)
+    {
+        qDebug() << "Failed to seed key search.";
+        secp256k1_context_destroy(ctx);
+        return;
+    }
+
+    unsigned char one[32] = {};
+    one[31] = 1;
+    secp256k1_pubkey generator;
+    if (secp256k1_ec_pubkey_create(ctx, &generator, one) != 1)
+    {
+        qDebug() << "Failed to create key search generator.";
+        secp256k1_context_destroy(ctx);
+        return;
+    }
+
+    // Candidates are walked from a random base by adding G to the point, the
+    // secret is only rebuilt from base + offset once a key matches
+    unsigned char base[32];
+    secp256k1_pubkey point;
+    secp256k1_pubkey next;
+    quint64 offset = 0;
+    bool seeded = false;
+
+    unsigned char serialized[33];
+    const auto key = serialized + 1;
+    qint64 tested = 0;
+
+    while (!state->stopped.loadRelaxed())
+    {
+        if (!seeded)
+        {
+            if (RAND_bytes(base, 32) != 1 || secp256k1_ec_pubkey_create(ctx, &point, base) != 1)
+                continue;
+
+            offset = 0;
+            seeded = true;
+        }
+
+        size_t len = sizeof(serialized);
+        secp256k1_ec_pubkey_serialize(ctx, serialized, &len, &point, SECP256K1_EC_COMPRESSED);
+
+        const auto matched = (type == NpubPrefix? matchBech32(key, prefix) : matchHex(key, prefix));
+        if (matched && state->stopped.testAndSetOrdered(0, 1))
+        {
+            unsigned char tweak[32] = {};
+            qToBigEndian<quint64>(offset, tweak + 24);
+
+            unsigned char secret[32];
+            memcpy(secret, base, 32);
+            if (offset == 0 || secp256k1_ec_seckey_tweak_add(ctx, secret, tweak) == 1)
+            {
+                QNostr::KeyPair k;
+                k.privateKey = QByteArray(reinterpret_cast<const char*>(secret), 32);
+                k.publicKey = QByteArray(reinterpret_cast<const char*>(key), 32);
+
+                // Results of a stopped or restarted run are dropped
+                QMetaObject::invokeMethod(search, [search, state, k](){
+                    if (search->p->state == state)
+                        search->finish(k);
+                }, Qt::QueuedConnection);
+            }
+        }
+
+        if (++tested == qnostr_keySearchReportStep)
+        {
+            state->tested.fetchAndAddRelaxed(tested);
+            tested = 0;
+        }
+
+        const secp256k1_pubkey *points[] = {&point, &generator};
+        if (secp256k1_ec_pubkey_combine(ctx, &next, points, 2) == 1)
+        {
+            point = next;
+            offset++;
+        }
+        else
+        {
+            seeded = false;
+        }
+    }
+
+    state->tested.fetchAndAddRelaxed(tested);
+    secp256k1_context_destroy(ctx);
+}
+
+QNostrKeySearch::QNostrKeySearch(QObject *parent)
+    : QObject(parent)
+{
+    p = new Private;
+    p->progressTimer = new QTimer(this);
+    p->progressTimer->setInterval(1000);
+
+    connect(p->progressTimer, &QTimer::timeout, this, &QNostrKeySearch::reportProgress);
+}
+
+QNostrKeySearch::~QNostrKeySearch()
+{
+    if (p->state)
+        p->state->stopped.storeRelaxed(1);
+    p->pool.waitForDone();
+    delete p;
+}
+
+bool QNostrKeySearch::running() const
+{
+    return p->state && !p->state->stopped.loadRelaxed();
+}
+
+qint64 QNostrKeySearch::testedKeys() const
+{
+    return p->state? p->state->tested.loadRelaxed() : 0;
+}
+
+bool QNostrKeySearch::start(const QString &prefix, PrefixType type, int threads)
+{
+    if (running())
+        return false;
+
+    auto text = prefix.toLower().toLatin1();
+    if (type == NpubPrefix && text.startsWith("npub1"))
+        text = text.mid(5);
+
+    // The prefix is converted to nibbles or 5 bit groups once, up front
+    QByteArray values;
+    for (auto c: text)
+    {
+        const auto v = (type == NpubPrefix? qnostr_bech32Charset().indexOf(c) : QByteArrayLiteral("0123456789abcdef").indexOf(c));
+        if (v < 0)
+        {
+            qDebug() << "Invalid character in key prefix:" << c;
+            return false;
+        }
+        values += static_cast<char>(v);
+    }
+
+    if (values.isEmpty() || values.size() > (type == NpubPrefix? 51 : 64))
+    {
+        qDebug() << "Invalid key prefix length.";
+        return false;
+    }
+
+    if (threads <= 0)
+        threads = QThread::idealThreadCount();
+
+    p->pool.waitForDone();
+    p->pool.setMaxThreadCount(threads);
+    p->state = QSharedPointer<Private::State>::create();
+    p->lastTested = 0;
+    p->lastElapsed = 0;
+    p->elapsed.start();
+    p->progressTimer->start();
+
+    const auto state = p->state;
+    for (int i = 0; i < threads; i++)
+        p->pool.start([state, values, type, this](){ Private::search(state, values, type, this); });
+
+    Q_EMIT runningChanged();
+    return true;
+}
+
+void QNostrKeySearch::stop()
+{
+    if (!running())
+        return;
+
+    p->state->stopped.storeRelaxed(1);
+    p->progressTimer->stop();
+    Q_EMIT runningChanged();
+}
+
+void QNostrKeySearch::finish(const QNostr::KeyPair &keyPair)
+{
+    p->progressTimer->stop();
+    reportProgress();
+
+    Q_EMIT found(keyPair);
+    Q_EMIT runningChanged();
+}
+
+void QNostrKeySearch::reportProgress()
+{
+    const auto tested = testedKeys();
+    const auto elapsed = p->elapsed.elapsed();
+    const auto delta = elapsed - p->lastElapsed;
+    const auto keysPerSecond = (delta > 0? (tested - p->lastTested) * 1000.0 / delta : 0.0);
+
+    p->lastTested = tested;
+    p->lastElapsed = elapsed;
+    Q_EMIT progress(tested, keysPerSecond);
+}
@@ -0,0 +1,48 @@
+#ifndef QNOSTRKEYSEARCH_H
+#define QNOSTRKEYSEARCH_H
+
+#include <QObject>
+
+#include "qnostr.h"
+
+QT_BEGIN_NAMESPACE
+
+class LIBQTNOSTR_CORE_EXPORT QNostrKeySearch : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(bool running READ running NOTIFY runningChanged)
+    class Private;
+
+public:
+    enum PrefixType {
+        HexPrefix,
+        NpubPrefix
+    };
+    Q_ENUM(PrefixType)
+
+    QNostrKeySearch(QObject *parent = nullptr);
+    virtual ~QNostrKeySearch();
+
+    bool running() const;
+    qint64 testedKeys() const;
+
+public Q_SLOTS:
+    bool start(const QString &prefix, PrefixType type = HexPrefix, int threads = 0);
+    void stop();
+
+Q_SIGNALS:
+    void found(const QNostr::KeyPair &keyPair);
+    void progress(qint64 testedKeys, double keysPerSecond);
+    void runningChanged();
+
+private:
+    void finish(const QNostr::KeyPair &keyPair);
+    void reportProgress();
+
+private:
+    Private *p;
+};
+
+QT_END_NAMESPACE
+
+#endif // QNOSTRKEYSEARCH_H
@@ -9,6 +9,7 @@
 #include <QJsonArray>
 
 #include <optional>
+#include <functional>
 
 #include "qtnostr_global.h"
 
@@ -32,8 +33,14 @@ public:
         std::optional<QString> sig;
 
         QJsonArray tagsArray() const;
+        QJsonObject toJsonObject() const;
         QString serialize() const;
         static Event deserialize(const QJsonObject &obj);
+
+        bool verify() const;
+
+        static bool isReplaceableKind(int kind);
+        static bool isParameterizedReplaceableKind(int kind);
     };
     struct LIBQTNOSTR_CORE_EXPORT Request {
         std::optional<QString> subscriptionId;
@@ -47,7 +54,9 @@ public:
         std::optional<QDateTime> until;
         int limit = 1;
 
+        QJsonObject toJsonObject(bool withLimit = true) const;
         QString serialize() const;
+        QString serializeCount() const;
     };
     struct LIBQTNOSTR_CORE_EXPORT Close {
         QString subscriptionId;
@@ -66,6 +75,7 @@ public Q_SLOTS:
     QString sendEvent(const QString &content);
     QString sendEvent(Event event, bool prepared = false);
     QString sendRequest(Request request);
+    QString sendCount(Request request);
     void sendClose(const Close &request);
     void sendClose(const QString &subscriptionId);
 
@@ -77,6 +87,7 @@ Q_SIGNALS:
     void newEvent(const QString &subscribeId, const Event &event, bool storedEvent);
     void notice(const QString &msg);
     void syncEventsFinished(const QString &subscribeId);
+    void countReceived(const QString &subscribeId, qint64 count, bool partial);
     void disconnected();
     void connected();
 
@@ -85,10 +96,30 @@ protected:
     static QByteArray sign(const QByteArray &data, const QByteArray &privateKey);
     static QByteArray compressedPublicKey(const QString &secretKey);
     static QByteArray extractPrivateKey(const QByteArray& base64SecretKey);
+    static QByteArray publicKeyFromPrivateKey(const QByteArray &privateKey);
+
+    static QByteArray sharedSecret(const QByteArray &privateKey, const QString &publicKey);
+    static QByteArray nip44ConversationKey(const QByteArray &sharedSecret);
+    static QString nip04Encrypt(const QString &content, const QByteArray &sharedSecret);
+    static QString nip04Decrypt(const QString &payload, const QByteArray &sharedSecret);
+    static QString nip44Encrypt(const QString &content, const QByteArray &conversationKey);
+    static QString nip44Decrypt(const QString &payload, const QByteArray &conversationKey);
 
     static void prepareEvent(Event &event, const QByteArray &publicKey, const QByteArray &privateKey);
 
 private:
+    typedef std::function<bool(const QString &subscribeId, const QJsonObject &event, bool storedEvent)> EventFilter;
+
+    void setEventFilter(const EventFilter &filter);
+
+    void checkCountDeadline(const QString &subscriptionId);
+    void sendCountCommand(const QString &subscriptionId);
+    void startCountFallback(const QString &subscriptionId);
+    void sendCountPage(const QString &subscriptionId);
+    void countFallbackEvent(const QString &subscriptionId, const QJsonObject &event);
+    void countFallbackPageFinished(const QString &subscriptionId);
+    void finishCount(const QString &subscriptionId, qint64 count, bool partial);
+
     void serverConnected();
     void serverDisonnected();
     void analizeData(const QString &data);